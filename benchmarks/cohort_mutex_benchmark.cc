@@ -0,0 +1,142 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "cohort_mutex.h"
+#include "mutex_protected.h"
+
+namespace {
+
+constexpr std::size_t simulated_nodes = 2;
+
+// Threads are assigned a simulated node when they start so that the cohort
+// lock can be measured on hosts with a single NUMA node.
+using simulated_topology = xyz::simulated_topology<simulated_nodes>;
+
+// Assigns the calling thread to a simulated node and, where supported, pins
+// it to a CPU in that node's half of the machine, matching the usual
+// numbering of CPUs on multi-socket hosts.
+void pin_to_simulated_node(std::size_t thread_index) {
+  const std::size_t node = thread_index % simulated_nodes;
+  simulated_topology::node = node;
+#if defined(__linux__)
+  const std::size_t cpus =
+      std::max<std::size_t>(1, std::thread::hardware_concurrency());
+  const std::size_t per_node = std::max<std::size_t>(1, cpus / simulated_nodes);
+  const std::size_t cpu =
+      (node * per_node + (thread_index / simulated_nodes) % per_node) % cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// Spans several cache lines so that moving it between nodes is costly.
+struct shared_state {
+  std::array<std::uint64_t, 32> data = {};
+  std::size_t last_node = 0;
+  std::uint64_t node_switches = 0;
+};
+
+template <class M>
+void BM_Uncontended(benchmark::State& state) {
+  // glibc's std::mutex skips atomic operations until the process starts a
+  // second thread, which any program that needs a mutex will have done.
+  std::thread([]() {}).join();
+  xyz::mutex_protected<int, M> value(0);
+  for (auto _ : state) {
+    value.with([](int& v) { ++v; });
+  }
+  benchmark::DoNotOptimize(*value.lock());
+}
+BENCHMARK(BM_Uncontended<std::mutex>);
+BENCHMARK(BM_Uncontended<xyz::cohort_mutex>);
+BENCHMARK(BM_Uncontended<xyz::basic_cohort_mutex<simulated_topology>>);
+
+// Runs `range(0)` threads, alternately assigned to the simulated nodes,
+// against one mutex_protected for a fixed time and reports:
+// - ops: total critical sections per second,
+// - fairness: the fewest critical sections run by one thread divided by the
+//   most, so 1 is perfectly fair,
+// - node_switches: the fraction of critical sections that ran on a different
+//   node to the previous one.
+template <class M>
+void BM_Contended(benchmark::State& state) {
+  const auto threads = static_cast<std::size_t>(state.range(0));
+  const auto duration = std::chrono::milliseconds(50);
+
+  double ops = 0;
+  double fairness = 0;
+  double node_switches = 0;
+  for (auto _ : state) {
+    xyz::mutex_protected<shared_state, M> value;
+    std::vector<std::uint64_t> counts(threads);
+    std::atomic<bool> stop = false;
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+      workers.emplace_back([&value, &counts, &stop, i]() {
+        pin_to_simulated_node(i);
+        std::uint64_t count = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+          value.with([](shared_state& s) {
+            for (auto& d : s.data) ++d;
+            if (s.last_node != simulated_topology::node) {
+              s.last_node = simulated_topology::node;
+              ++s.node_switches;
+            }
+          });
+          ++count;
+        }
+        counts[i] = count;
+      });
+    }
+    std::this_thread::sleep_for(duration);
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    const auto [min, max] = std::minmax_element(counts.begin(), counts.end());
+    const auto locked = value.lock();
+    ops += locked->data[0];
+    fairness += *max == 0 ? 1.0 : static_cast<double>(*min) / *max;
+    node_switches += locked->node_switches;
+  }
+  state.counters["ops"] = benchmark::Counter(ops, benchmark::Counter::kIsRate);
+  state.counters["fairness"] = fairness / state.iterations();
+  state.counters["node_switches"] = ops == 0 ? 0 : node_switches / ops;
+}
+BENCHMARK(BM_Contended<std::mutex>)
+    ->ArgName("threads")
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->Iterations(5)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Contended<xyz::basic_cohort_mutex<simulated_topology>>)
+    ->ArgName("threads")
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->Iterations(5)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -0,0 +1,142 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <numeric>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "benchmarks/with_call_sites.h"
+#include "mutex_protected.h"
+
+namespace {
+
+using payload = std::vector<int>;
+
+constexpr int payload_size = 64;
+
+// Repeatedly modifies a protected value from a background thread for as long
+// as it is alive.
+template <typename Protected>
+class background_writer {
+ public:
+  explicit background_writer(Protected& p)
+      : thread([&p, this]() {
+          while (!stop.load(std::memory_order_relaxed)) {
+            p.with([](payload& v) { ++v[0]; });
+          }
+        }) {}
+
+  ~background_writer() {
+    stop.store(true, std::memory_order_relaxed);
+    thread.join();
+  }
+
+ private:
+  std::atomic<bool> stop = false;
+  std::thread thread;
+};
+
+template <typename Protected>
+Protected& shared_instance() {
+  static Protected p(payload(payload_size, 1));
+  return p;
+}
+
+void BM_WithSharedRead(benchmark::State& state) {
+  using protected_type = xyz::mutex_protected<payload, std::shared_mutex>;
+  auto& p = shared_instance<protected_type>();
+  std::optional<background_writer<protected_type>> writer;
+  if (state.thread_index() == 0 && state.range(0) != 0) writer.emplace(p);
+
+  for (auto _ : state) {
+    int sum = 0;
+    p.with_shared([&sum](const payload& v) {
+      sum = std::accumulate(v.begin(), v.end(), 0);
+    });
+    benchmark::DoNotOptimize(sum);
+  }
+}
+BENCHMARK(BM_WithSharedRead)->ArgName("writer")->Arg(0)->Arg(1)->ThreadRange(
+    1, 8);
+
+void BM_SnapshotRead(benchmark::State& state) {
+  using protected_type = xyz::snapshot_protected<payload, std::mutex>;
+  auto& p = shared_instance<protected_type>();
+  std::optional<background_writer<protected_type>> writer;
+  if (state.thread_index() == 0 && state.range(0) != 0) writer.emplace(p);
+
+  for (auto _ : state) {
+    auto snapshot = p.snapshot();
+    int sum = std::accumulate(snapshot->begin(), snapshot->end(), 0);
+    benchmark::DoNotOptimize(sum);
+  }
+}
+BENCHMARK(BM_SnapshotRead)->ArgName("writer")->Arg(0)->Arg(1)->ThreadRange(
+    1, 8);
+
+// The cost of a write when no reader has asked for a snapshot should match
+// mutex_protected.
+template <typename Protected>
+void BM_Write(benchmark::State& state) {
+  Protected p(payload(payload_size, 1));
+  for (auto _ : state) {
+    p.with([](payload& v) { ++v[0]; });
+  }
+}
+BENCHMARK(BM_Write<xyz::mutex_protected<payload, std::mutex>>);
+BENCHMARK(BM_Write<xyz::snapshot_protected<payload, std::mutex>>);
+
+// The worst case for snapshot_protected: every write is preceded by a
+// snapshot request so every write publishes a copy.
+void BM_SnapshotWriteAfterRead(benchmark::State& state) {
+  xyz::snapshot_protected<payload, std::mutex> p(payload(payload_size, 1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(p.snapshot());
+    p.with([](payload& v) { ++v[0]; });
+  }
+}
+BENCHMARK(BM_SnapshotWriteAfterRead);
+
+void BM_With(benchmark::State& state) {
+  xyz::mutex_protected<int> value(0);
+  for (auto _ : state) {
+    value.with([](int& v) { ++v; });
+  }
+  benchmark::DoNotOptimize(*value.lock());
+}
+BENCHMARK(BM_With);
+
+void BM_WithRef(benchmark::State& state) {
+  xyz::mutex_protected<int> value(0);
+  for (auto _ : state) {
+    value.with_ref([](int& v) { ++v; });
+  }
+  benchmark::DoNotOptimize(*value.lock());
+}
+BENCHMARK(BM_WithRef);
+
+// Calling many distinct call sites exercises the instruction cache, which is
+// where the smaller code of with_ref can pay for its indirect call.
+void BM_WithCallSites(benchmark::State& state) {
+  xyz::mutex_protected<int> value(0);
+  for (auto _ : state) {
+    xyz::benchmarks::run_with_call_sites(value);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          xyz::benchmarks::with_call_site_count);
+}
+BENCHMARK(BM_WithCallSites);
+
+void BM_WithRefCallSites(benchmark::State& state) {
+  xyz::mutex_protected<int> value(0);
+  for (auto _ : state) {
+    xyz::benchmarks::run_with_ref_call_sites(value);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          xyz::benchmarks::with_call_site_count);
+}
+BENCHMARK(BM_WithRefCallSites);
+
+}  // namespace
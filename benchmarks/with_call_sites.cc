@@ -0,0 +1,44 @@
+// Generates many distinct call sites of either mutex_protected::with or
+// mutex_protected::with_ref to compare the code size of the two. This file is
+// compiled twice, once with XYZ_USE_WITH_REF defined to 0 and once with it
+// defined to 1, so that the two object files can be compared directly.
+#include "benchmarks/with_call_sites.h"
+
+#include <cstddef>
+#include <utility>
+
+#ifndef XYZ_USE_WITH_REF
+#error "XYZ_USE_WITH_REF must be defined to 0 or 1"
+#endif
+
+namespace xyz::benchmarks {
+namespace {
+
+// Each instantiation has its own closure type, so with<F> is instantiated
+// once per call site.
+template <std::size_t I>
+void call_site(mutex_protected<int>& value) {
+  auto f = [](int& v) { v = v * 31 + static_cast<int>(I); };
+#if XYZ_USE_WITH_REF
+  value.with_ref(f);
+#else
+  value.with(f);
+#endif
+}
+
+template <std::size_t... I>
+void call_sites(mutex_protected<int>& value, std::index_sequence<I...>) {
+  (call_site<I>(value), ...);
+}
+
+}  // namespace
+
+#if XYZ_USE_WITH_REF
+void run_with_ref_call_sites(mutex_protected<int>& value) {
+#else
+void run_with_call_sites(mutex_protected<int>& value) {
+#endif
+  call_sites(value, std::make_index_sequence<with_call_site_count>{});
+}
+
+}  // namespace xyz::benchmarks
@@ -0,0 +1,20 @@
+#ifndef XYZ_MUTEX_PROTECTED_BENCHMARKS_WITH_CALL_SITES_H
+#define XYZ_MUTEX_PROTECTED_BENCHMARKS_WITH_CALL_SITES_H
+
+#include "mutex_protected.h"
+
+namespace xyz::benchmarks {
+
+// The number of distinct call sites, each with its own lambda, in each of
+// the functions below.
+inline constexpr int with_call_site_count = 256;
+
+// Calls mutex_protected::with from every call site once.
+void run_with_call_sites(mutex_protected<int>& value);
+
+// Calls mutex_protected::with_ref from every call site once.
+void run_with_ref_call_sites(mutex_protected<int>& value);
+
+}  // namespace xyz::benchmarks
+
+#endif  // XYZ_MUTEX_PROTECTED_BENCHMARKS_WITH_CALL_SITES_H
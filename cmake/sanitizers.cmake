@@ -1,12 +1,19 @@
 include_guard(GLOBAL)
 
+include(CheckCXXCompilerFlag)
+include(CMakePushCheckState)
+
 if (ENABLE_SANITIZERS)
-    set(SANITIZER_FLAGS_ASAN "-fsanitize=address -fno-omit-frame-pointer")
+    set(SANITIZER_FLAGS_ASAN -fsanitize=address -fno-omit-frame-pointer)
     set(SANITIZER_FLAGS_UBSAN "-fsanitize=undefined")
 
-    include(CheckCXXCompilerFlag)
-    check_cxx_compiler_flag("${SANITIZER_FLAGS_ASAN}" COMPILER_SUPPORTS_ASAN)
+    # The sanitizer runtimes must also be linked for the checks to succeed.
+    cmake_push_check_state()
+    set(CMAKE_REQUIRED_LINK_OPTIONS "-fsanitize=address")
+    check_cxx_compiler_flag("-fsanitize=address" COMPILER_SUPPORTS_ASAN)
+    set(CMAKE_REQUIRED_LINK_OPTIONS "-fsanitize=undefined")
     check_cxx_compiler_flag("${SANITIZER_FLAGS_UBSAN}" COMPILER_SUPPORTS_UBSAN)
+    cmake_pop_check_state()
 
     if (COMPILER_SUPPORTS_ASAN)
         add_library(asan INTERFACE IMPORTED)
@@ -24,3 +31,26 @@ if (ENABLE_SANITIZERS)
         )
     endif(COMPILER_SUPPORTS_UBSAN)
 endif(ENABLE_SANITIZERS)
+
+# Thread Sanitizer cannot be combined with Address Sanitizer so it has its own
+# option.
+if (ENABLE_THREAD_SANITIZER)
+    if (ENABLE_SANITIZERS)
+        message(FATAL_ERROR "ENABLE_THREAD_SANITIZER cannot be combined with ENABLE_SANITIZERS")
+    endif()
+
+    set(SANITIZER_FLAGS_TSAN "-fsanitize=thread")
+
+    cmake_push_check_state()
+    set(CMAKE_REQUIRED_LINK_OPTIONS "${SANITIZER_FLAGS_TSAN}")
+    check_cxx_compiler_flag("${SANITIZER_FLAGS_TSAN}" COMPILER_SUPPORTS_TSAN)
+    cmake_pop_check_state()
+
+    if (COMPILER_SUPPORTS_TSAN)
+        add_library(tsan INTERFACE IMPORTED)
+        set_target_properties(tsan PROPERTIES
+            INTERFACE_COMPILE_OPTIONS "${SANITIZER_FLAGS_TSAN}"
+            INTERFACE_LINK_OPTIONS "${SANITIZER_FLAGS_TSAN}"
+        )
+    endif(COMPILER_SUPPORTS_TSAN)
+endif(ENABLE_THREAD_SANITIZER)
@@ -81,7 +81,8 @@ function(xyz_add_test)
             GTest::gtest_main
             common_compiler_settings
             $<$<BOOL:${COMPILER_SUPPORTS_ASAN}>:asan>
-            $<$<BOOL:${COMPILER_SUPPORTS_USAN}>:ubsan>
+            $<$<BOOL:${COMPILER_SUPPORTS_UBSAN}>:ubsan>
+            $<$<BOOL:${COMPILER_SUPPORTS_TSAN}>:tsan>
     )
 
     set_target_properties(${XYZ_NAME} PROPERTIES
@@ -0,0 +1,2 @@
+// A cc file to ensure that the header file can be compiled.
+#include "cohort_mutex.h"
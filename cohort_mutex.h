@@ -0,0 +1,345 @@
+#ifndef XYZ_COHORT_MUTEX_H
+#define XYZ_COHORT_MUTEX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace xyz {
+
+// Reports the NUMA node the calling thread is running on. Falls back to a
+// single node where the topology cannot be determined.
+struct numa_topology {
+  static std::size_t node_count() {
+    static const std::size_t count = read_node_count();
+    return count;
+  }
+
+  // Looking up the node costs more than an uncontended lock, so it is cached
+  // per thread and refreshed periodically to follow threads that migrate.
+  static std::size_t current_node() {
+    thread_local std::size_t node = 0;
+    thread_local unsigned calls = 0;
+    if (calls++ % refresh_interval == 0) node = read_current_node();
+    return node;
+  }
+
+ private:
+  static constexpr unsigned refresh_interval = 64;
+
+  static std::size_t read_current_node() {
+#if defined(__linux__)
+    unsigned cpu = 0;
+    unsigned node = 0;
+    // __GLIBC_PREREQ is only defined by glibc, so it cannot be tested in the
+    // same #if as its use.
+#if defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 29)
+    // glibc's getcpu uses the vDSO, avoiding a system call.
+    if (getcpu(&cpu, &node) == 0) return node;
+#endif
+#endif
+#if defined(SYS_getcpu)
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return node;
+#endif
+#endif
+    return 0;
+  }
+
+  // Only nodes with CPUs can be returned by getcpu, so memory-only nodes and
+  // the many nodes firmware may declare possible are not counted. A node that
+  // comes online later shares a cohort with another node.
+  static std::size_t read_node_count() {
+    for (const char* path : {"/sys/devices/system/node/has_cpu",
+                             "/sys/devices/system/node/online"}) {
+      if (const std::size_t count = read_node_list(path)) return count;
+    }
+    return 1;
+  }
+
+  // Parses the highest node number from a list such as "0-1" or "0,2-3",
+  // returning 0 if the list cannot be read.
+  static std::size_t read_node_list(const char* path) {
+    std::ifstream list(path);
+    std::string nodes;
+    if (!(list >> nodes) || nodes.empty()) return 0;
+    const std::size_t last = nodes.find_last_of(",-");
+    try {
+      return std::stoul(last == std::string::npos ? nodes
+                                                  : nodes.substr(last + 1)) +
+             1;
+    } catch (...) {
+      return 0;
+    }
+  }
+};
+
+// A topology of NodeCount simulated nodes, for exercising basic_cohort_mutex
+// on hosts with a single NUMA node. Each thread starts on node 0 and can move
+// itself to another node by assigning to `node`.
+template <std::size_t NodeCount>
+struct simulated_topology {
+  static inline thread_local std::size_t node = 0;
+
+  static std::size_t node_count() { return NodeCount; }
+  static std::size_t current_node() { return node; }
+};
+
+namespace detail {
+
+// A lock that may be released by a thread other than the one that acquired
+// it, as cohort locking requires, and can report whether anyone is waiting
+// for it. Like std::mutex it does not queue waiters in order, so try_lock and
+// std::lock remain effective under contention.
+//
+// The lowest bit of the state is set while the lock is held and the remaining
+// bits count waiters, so that unlocking is a single atomic operation that also
+// tells it whether to wake a waiter.
+class oblivious_lock {
+ public:
+  void lock() noexcept {
+    if (try_lock()) return;
+    std::uint32_t s =
+        state.fetch_add(waiter, std::memory_order_relaxed) + waiter;
+    for (int spins = 0;; ++spins) {
+      // Acquire the lock and stop counting as a waiter in one step.
+      while ((s & locked) == 0) {
+        if (state.compare_exchange_weak(s, (s - waiter) | locked,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+          return;
+        }
+      }
+      if (spins >= spin_limit) {
+        state.wait(s, std::memory_order_relaxed);
+      }
+      s = state.load(std::memory_order_relaxed);
+    }
+  }
+
+  bool try_lock() noexcept {
+    std::uint32_t s = state.load(std::memory_order_relaxed);
+    while ((s & locked) == 0) {
+      if (state.compare_exchange_weak(s, s | locked, std::memory_order_acquire,
+                                      std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void unlock() noexcept {
+    if (state.fetch_sub(locked, std::memory_order_release) != locked) {
+      state.notify_one();
+    }
+  }
+
+  // Whether a thread is waiting in lock(). Waiters stop counting when they
+  // acquire the lock, so while the lock is held a waiter is never reported
+  // that will not go on to acquire it.
+  bool has_waiters() const noexcept {
+    return (state.load(std::memory_order_relaxed) & ~locked) != 0;
+  }
+
+ private:
+  static constexpr int spin_limit = 128;
+  static constexpr std::uint32_t locked = 1;
+  static constexpr std::uint32_t waiter = 2;
+
+  std::atomic<std::uint32_t> state = 0;
+};
+
+// The lock that nodes compete for. Only the thread holding a node's local
+// lock takes it, so there are never more waiters than nodes. Waiters spin
+// briefly and then sleep, counting themselves so that unlocking only wakes a
+// waiter when there is one.
+class node_lock {
+ public:
+  void lock() noexcept {
+    if (try_lock()) return;
+    // Sequentially consistent so that either unlock() sees this waiter or
+    // the waiter sees the lock released before it sleeps.
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+    for (int spins = 0; !try_lock(); ++spins) {
+      if (spins >= spin_limit) {
+        held.wait(true, std::memory_order_seq_cst);
+      }
+    }
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  bool try_lock() noexcept {
+    return !held.load(std::memory_order_relaxed) &&
+           !held.exchange(true, std::memory_order_acquire);
+  }
+
+  void unlock() noexcept {
+    held.store(false, std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_seq_cst) != 0) {
+      held.notify_one();
+    }
+  }
+
+  // Whether a node is waiting in lock(). Waiters stop counting before they
+  // release the lock, so its holder never sees a waiter that has already had
+  // its turn.
+  bool has_waiters() const noexcept {
+    return waiters.load(std::memory_order_relaxed) != 0;
+  }
+
+ private:
+  static constexpr int spin_limit = 128;
+
+  std::atomic<bool> held = false;
+  std::atomic<std::uint32_t> waiters = 0;
+};
+
+}  // namespace detail
+
+// A NUMA-aware cohort lock (Dice, Marathe and Shavit, "Lock Cohorting").
+//
+// Threads first take a lock local to their node, then a global lock. On
+// unlock, if another thread on the same node is waiting, ownership of the
+// global lock is passed to it along with the local lock so that the protected
+// data stays in the node's caches. After MaxLocalHandoffs consecutive local
+// handoffs the global lock is released, and if another node is waiting for
+// it, this node does not take it again until another node has. Within a node
+// neither lock queues waiters in order, so fairness between threads on the
+// same node is best effort, as with std::mutex.
+//
+// Topology must provide static node_count() and current_node() functions.
+template <class Topology = numa_topology, unsigned MaxLocalHandoffs = 64>
+class basic_cohort_mutex {
+ public:
+  basic_cohort_mutex()
+      : node_count(Topology::node_count() > 0 ? Topology::node_count() : 1),
+        cohorts(std::make_unique<cohort[]>(node_count)) {}
+
+  basic_cohort_mutex(const basic_cohort_mutex &) = delete;
+  basic_cohort_mutex &operator=(const basic_cohort_mutex &) = delete;
+
+  void lock() {
+    const std::size_t node = Topology::current_node() % node_count;
+    cohort &c = cohorts[node];
+    c.local.lock();
+    if (!c.global_held) {
+      if (c.yielding) {
+        while (global_generation.load(std::memory_order_acquire) ==
+               c.yielded_generation) {
+          global_generation.wait(c.yielded_generation,
+                                 std::memory_order_acquire);
+        }
+        stop_yielding(c);
+      }
+      global.lock();
+      acquired_global();
+      c.global_held = true;
+    }
+    owner_node = node;
+  }
+
+  bool try_lock() {
+    const std::size_t node = Topology::current_node() % node_count;
+    cohort &c = cohorts[node];
+    if (!c.local.try_lock()) return false;
+    if (!c.global_held) {
+      if (c.yielding) {
+        if (global_generation.load(std::memory_order_acquire) ==
+            c.yielded_generation) {
+          c.local.unlock();
+          return false;
+        }
+        stop_yielding(c);
+      }
+      if (!global.try_lock()) {
+        c.local.unlock();
+        return false;
+      }
+      acquired_global();
+      c.global_held = true;
+    }
+    owner_node = node;
+    return true;
+  }
+
+  void unlock() {
+    cohort &c = cohorts[owner_node];
+    const bool local_waiters = c.local.has_waiters();
+    if (local_waiters && c.handoffs < MaxLocalHandoffs) {
+      ++c.handoffs;
+    } else {
+      if (local_waiters && global.has_waiters()) {
+        // Barging would let this node's next thread take the global lock
+        // again before the other node's waiter wakes up, so hold this node
+        // back until another node has taken it. Counting the yielding node
+        // before releasing the global lock ensures the next holder sees it.
+        c.yielding = true;
+        c.yielded_generation =
+            global_generation.load(std::memory_order_relaxed);
+        yielding_nodes.fetch_add(1, std::memory_order_relaxed);
+      }
+      c.handoffs = 0;
+      c.global_held = false;
+      global.unlock();
+    }
+    c.local.unlock();
+  }
+
+ private:
+  friend struct cohort_mutex_test_peer;
+
+  // Per-node state, protected by local.
+  struct alignas(64) cohort {
+    detail::oblivious_lock local;
+    bool global_held = false;
+    // Whether this node is waiting for another node to take the global lock
+    // after it last reached MaxLocalHandoffs.
+    bool yielding = false;
+    unsigned handoffs = 0;
+    std::uint32_t yielded_generation = 0;
+  };
+
+  // Called with the global lock held. Nodes only wait for the generation to
+  // change while yielding, so it is left alone otherwise.
+  void acquired_global() {
+    if (yielding_nodes.load(std::memory_order_relaxed) != 0) {
+      global_generation.store(
+          global_generation.load(std::memory_order_relaxed) + 1,
+          std::memory_order_release);
+      global_generation.notify_all();
+    }
+  }
+
+  void stop_yielding(cohort &c) {
+    c.yielding = false;
+    yielding_nodes.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // The members are laid out on three cache lines so that each is only
+  // written by the threads that need it: the read-mostly node_count and
+  // cohorts, the global lock that waiting nodes poll, and owner_node, which
+  // every owner writes without contending with those waiters.
+  std::size_t node_count;
+  std::unique_ptr<cohort[]> cohorts;
+  alignas(64) detail::node_lock global;
+  // Written only while holding the global lock.
+  std::atomic<std::uint32_t> global_generation = 0;
+  std::atomic<std::uint32_t> yielding_nodes = 0;
+  // The node of the current owner, protected by the lock itself.
+  alignas(64) std::size_t owner_node = 0;
+};
+
+using cohort_mutex = basic_cohort_mutex<>;
+
+}  // namespace xyz
+
+#endif  // XYZ_COHORT_MUTEX_H
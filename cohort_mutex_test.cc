@@ -0,0 +1,212 @@
+#include "cohort_mutex.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mutex_protected.h"
+
+namespace xyz {
+
+// Inspects which locks of a basic_cohort_mutex have waiters so that tests can
+// wait for threads to queue rather than sleeping.
+struct cohort_mutex_test_peer {
+  template <class M>
+  static bool has_local_waiters(const M& m, std::size_t node) {
+    return m.cohorts[node].local.has_waiters();
+  }
+
+  template <class M>
+  static bool has_global_waiters(const M& m) {
+    return m.global.has_waiters();
+  }
+
+  // The cache lines holding the read-mostly members, the global lock and the
+  // owner's node.
+  template <class M>
+  static std::vector<std::uintptr_t> cache_lines(const M& m) {
+    return {reinterpret_cast<std::uintptr_t>(&m.cohorts) / 64,
+            reinterpret_cast<std::uintptr_t>(&m.yielding_nodes) / 64,
+            reinterpret_cast<std::uintptr_t>(&m.owner_node) / 64};
+  }
+};
+
+namespace {
+
+using two_node_topology = simulated_topology<2>;
+using three_node_topology = simulated_topology<3>;
+
+// Reports no nodes, and a current node beyond the reported count.
+struct inconsistent_topology {
+  static std::size_t node_count() { return 0; }
+  static std::size_t current_node() { return 7; }
+};
+
+static_assert(Mutex<cohort_mutex>);
+static_assert(Mutex<basic_cohort_mutex<two_node_topology>>);
+
+TEST(NumaTopologyTest, CurrentNodeIsInRange) {
+  EXPECT_GE(numa_topology::node_count(), 1u);
+  EXPECT_LT(numa_topology::current_node(), numa_topology::node_count());
+}
+
+TEST(CohortMutexLayoutTest, OwnerNodeHasItsOwnCacheLine) {
+  const cohort_mutex m;
+  const std::vector<std::uintptr_t> lines =
+      cohort_mutex_test_peer::cache_lines(m);
+  EXPECT_NE(lines[0], lines[1]);
+  EXPECT_NE(lines[1], lines[2]);
+  EXPECT_NE(lines[0], lines[2]);
+}
+
+template <typename T>
+class CohortMutexTest : public testing::Test {};
+
+using CohortMutexes =
+    ::testing::Types<cohort_mutex, basic_cohort_mutex<two_node_topology>,
+                     basic_cohort_mutex<two_node_topology, 0>,
+                     basic_cohort_mutex<inconsistent_topology>>;
+TYPED_TEST_SUITE(CohortMutexTest, CohortMutexes);
+
+TYPED_TEST(CohortMutexTest, LockAndUnlock) {
+  mutex_protected<int, TypeParam> value(0);
+  *value.lock() += 1;
+  value.with([](int& v) { v++; });
+  EXPECT_EQ(*value.lock(), 2);
+}
+
+TYPED_TEST(CohortMutexTest, TryLockFailsIfLocked) {
+  mutex_protected<int, TypeParam> value(0);
+  {
+    auto locked = value.lock();
+    std::thread t([&value]() {
+      auto locked = value.try_lock();
+      EXPECT_FALSE(locked.owns_lock());
+    });
+    t.join();
+  }
+  auto locked = value.try_lock();
+  EXPECT_TRUE(locked.owns_lock());
+}
+
+TYPED_TEST(CohortMutexTest, LockMultiple) {
+  mutex_protected<int, TypeParam> a(1);
+  mutex_protected<int, TypeParam> b(2);
+  auto [la, lb] = xyz::lock_protected(a, b);
+  EXPECT_EQ(*la, 1);
+  EXPECT_EQ(*lb, 2);
+}
+
+TYPED_TEST(CohortMutexTest, ThreadSafetyCorrectness) {
+  mutex_protected<int, TypeParam> value(0);
+
+  std::vector<std::thread> threads;
+  threads.reserve(10);
+  for (int i = 0; i < 10; ++i) {
+    threads.emplace_back([&value, i]() {
+      two_node_topology::node = i % 2;
+      for (int j = 0; j < 10000; ++j) {
+        if (j % 2 == 0) {
+          *value.lock() += 1;
+        } else {
+          while (!value.try_with([](int& v) { v++; })) {
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(*value.lock(), 100000);
+}
+
+template <class Predicate>
+void wait_until(Predicate predicate) {
+  while (!predicate()) {
+    std::this_thread::yield();
+  }
+}
+
+// Runs threads on node 0 that each queue for the lock while the previous one
+// holds it, and a thread on node 1 that queues for the lock once node 0 has
+// it. Node 2 probes the lock with try_lock while each node 0 thread is queued.
+// Returns the order in which the threads acquired the lock, with the node 1
+// thread recorded as "remote".
+template <unsigned MaxLocalHandoffs>
+std::vector<std::string> acquisition_order() {
+  using mutex = basic_cohort_mutex<three_node_topology, MaxLocalHandoffs>;
+  mutex m;
+  std::vector<std::string> order;  // Protected by m.
+  std::atomic<std::size_t> acquired = 0;
+  std::vector<std::atomic<bool>> release(MaxLocalHandoffs + 1);
+
+  three_node_topology::node = 0;
+  m.lock();
+  std::thread remote([&]() {
+    three_node_topology::node = 1;
+    m.lock();
+    order.push_back("remote");
+    acquired++;
+    m.unlock();
+  });
+  wait_until([&]() { return cohort_mutex_test_peer::has_global_waiters(m); });
+
+  std::vector<std::thread> locals;
+  for (unsigned i = 0; i <= MaxLocalHandoffs; ++i) {
+    locals.emplace_back([&, i]() {
+      three_node_topology::node = 0;
+      m.lock();
+      order.push_back("local" + std::to_string(i));
+      acquired++;
+      release[i].wait(false);
+      m.unlock();
+    });
+    wait_until(
+        [&]() { return cohort_mutex_test_peer::has_local_waiters(m, 0); });
+
+    three_node_topology::node = 2;
+    EXPECT_FALSE(m.try_lock()) << "before local" << i;
+    three_node_topology::node = 0;
+
+    if (i == 0) {
+      m.unlock();
+    } else {
+      release[i - 1] = true;
+      release[i - 1].notify_one();
+    }
+    // Every handoff before the limit goes to the waiting local thread.
+    if (i < MaxLocalHandoffs) {
+      wait_until([&]() { return acquired == i + 1; });
+    }
+  }
+  release[MaxLocalHandoffs] = true;
+  release[MaxLocalHandoffs].notify_one();
+
+  remote.join();
+  for (auto& local : locals) {
+    local.join();
+  }
+  three_node_topology::node = 2;
+  EXPECT_TRUE(m.try_lock());
+  m.unlock();
+  three_node_topology::node = 0;
+  return order;
+}
+
+TEST(CohortMutexHandoffTest, RemoteNodeGetsLockAfterMaxLocalHandoffs) {
+  EXPECT_EQ(acquisition_order<2>(),
+            (std::vector<std::string>{"local0", "local1", "remote", "local2"}));
+}
+
+TEST(CohortMutexHandoffTest, RemoteNodeGetsLockImmediatelyWithoutHandoffs) {
+  EXPECT_EQ(acquisition_order<0>(),
+            (std::vector<std::string>{"remote", "local0"}));
+}
+
+}  // namespace
+}  // namespace xyz
@@ -1,8 +1,12 @@
 #ifndef XYZ_MUTEX_PROTECTED_H
 #define XYZ_MUTEX_PROTECTED_H
 
+#include <atomic>
 #include <chrono>
 #include <concepts>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <thread>
@@ -37,6 +41,78 @@ concept TimedMutex = Mutex<M> && requires(M m) {
   } -> std::convertible_to<bool>;
 };
 
+#if defined(_MSC_VER)
+#define XYZ_MUTEX_PROTECTED_NOINLINE __declspec(noinline)
+#else
+#define XYZ_MUTEX_PROTECTED_NOINLINE __attribute__((noinline))
+#endif
+
+template <class Signature>
+class function_ref;
+
+// A non-owning, non-allocating reference to a callable, similar to C++26's
+// std::function_ref. The referenced callable must outlive the function_ref,
+// which is the case when one is constructed from a lambda at a call site.
+// Functions and function pointers are stored by value, so
+// `function_ref f = &free_function;` does not dangle.
+template <class R, class... Args>
+class function_ref<R(Args...)> {
+  template <class F>
+  static constexpr bool is_function_pointer =
+      std::is_pointer_v<F> && std::is_function_v<std::remove_pointer_t<F>>;
+
+ public:
+  template <class F>
+    requires(!std::is_same_v<std::remove_cvref_t<F>, function_ref> &&
+             !is_function_pointer<std::remove_cvref_t<F>> &&
+             (std::is_object_v<std::remove_reference_t<F>> ||
+              std::is_function_v<std::remove_reference_t<F>>) &&
+             std::is_invocable_r_v<R, F &, Args...>)
+  function_ref(F &&f) noexcept : call(&invoke<std::remove_reference_t<F>>) {
+    if constexpr (std::is_function_v<std::remove_reference_t<F>>) {
+      bound.fn = reinterpret_cast<void (*)()>(&f);
+    } else {
+      bound.obj =
+          const_cast<void *>(static_cast<const void *>(std::addressof(f)));
+    }
+  }
+
+  template <class F>
+    requires(std::is_function_v<F> && std::is_invocable_r_v<R, F &, Args...>)
+  function_ref(F *f) noexcept : call(&invoke<F>) {
+    bound.fn = reinterpret_cast<void (*)()>(f);
+  }
+
+  R operator()(Args... args) const {
+    return call(bound, std::forward<Args>(args)...);
+  }
+
+ private:
+  // Function pointers cannot portably be converted to void *.
+  union storage {
+    void *obj;
+    void (*fn)();
+  };
+
+  template <class F>
+  static R invoke(storage bound, Args... args) {
+    F *f;
+    if constexpr (std::is_function_v<F>) {
+      f = reinterpret_cast<F *>(bound.fn);
+    } else {
+      f = static_cast<F *>(bound.obj);
+    }
+    if constexpr (std::is_void_v<R>) {
+      std::invoke(*f, std::forward<Args>(args)...);
+    } else {
+      return std::invoke(*f, std::forward<Args>(args)...);
+    }
+  }
+
+  storage bound;
+  R (*call)(storage, Args...);
+};
+
 template <class T, class G>
 class [[nodiscard]] mutex_locked {
  public:
@@ -79,6 +155,10 @@ class [[nodiscard]] mutex_locked {
 
   template <class T_, Mutex M_>
   friend class mutex_protected;
+
+  template <class T_, Mutex M_>
+    requires std::copy_constructible<T_>
+  friend class snapshot_protected;
 };
 
 template <class T, Mutex M = std::mutex>
@@ -161,6 +241,57 @@ class mutex_protected {
     }
   }
 
+  // Versions of with and the try_with variants that take a function_ref. The
+  // locking code is emitted once per mutex_protected<T, M> (and, for the timed
+  // variants, per clock or duration type) rather than once per callable,
+  // which reduces code size when there are many call sites, at the cost of an
+  // indirect call.
+  XYZ_MUTEX_PROTECTED_NOINLINE void with_ref(function_ref<void(T &)> f) {
+    std::lock_guard guard(mutex);
+    f(v);
+  }
+
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_ref(
+      function_ref<void(T &)> f) {
+    std::unique_lock guard(mutex, std::try_to_lock);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <class Clock, class Duration>
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_ref_until(
+      const std::chrono::time_point<Clock, Duration> &timeout_time,
+      function_ref<void(T &)> f)
+    requires TimedMutex<M>
+  {
+    std::unique_lock guard(mutex, timeout_time);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <class Rep, class Period>
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_ref_for(
+      const std::chrono::duration<Rep, Period> &timeout_duration,
+      function_ref<void(T &)> f)
+    requires TimedMutex<M>
+  {
+    std::unique_lock guard(mutex, timeout_duration);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
   mutex_locked<const T, std::shared_lock<M>> lock_shared()
     requires SharedMutex<M>
   {
@@ -212,6 +343,27 @@ class mutex_protected {
     }
   }
 
+  XYZ_MUTEX_PROTECTED_NOINLINE void with_shared_ref(
+      function_ref<void(const T &)> f)
+    requires SharedMutex<M>
+  {
+    std::shared_lock guard(mutex);
+    f(static_cast<const T &>(v));
+  }
+
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_shared_ref(
+      function_ref<void(const T &)> f)
+    requires SharedMutex<M>
+  {
+    std::shared_lock guard(mutex, std::try_to_lock);
+    if (guard.owns_lock()) {
+      f(static_cast<const T &>(v));
+      return true;
+    } else {
+      return false;
+    }
+  }
+
   template <class Clock, class Duration, typename F>
   [[nodiscard]] bool try_with_shared_until(
       const std::chrono::time_point<Clock, Duration> &timeout_time, F &&f)
@@ -240,6 +392,36 @@ class mutex_protected {
     }
   }
 
+  template <class Clock, class Duration>
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_shared_ref_until(
+      const std::chrono::time_point<Clock, Duration> &timeout_time,
+      function_ref<void(const T &)> f)
+    requires SharedMutex<M> && TimedMutex<M>
+  {
+    std::shared_lock m_lock(mutex, timeout_time);
+    if (m_lock.owns_lock()) {
+      f(static_cast<const T &>(v));
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <class Rep, class Period>
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_shared_ref_for(
+      const std::chrono::duration<Rep, Period> &timeout_duration,
+      function_ref<void(const T &)> f)
+    requires SharedMutex<M> && TimedMutex<M>
+  {
+    std::shared_lock m_lock(mutex, timeout_duration);
+    if (m_lock.owns_lock()) {
+      f(static_cast<const T &>(v));
+      return true;
+    } else {
+      return false;
+    }
+  }
+
  private:
   M mutex;
   T v;
@@ -260,6 +442,301 @@ auto lock_protected(MutexProtected &...mps) {
   return std::make_tuple(mps.adopt_lock()...);
 }
 
+namespace detail {
+
+// libstdc++'s std::atomic<std::shared_ptr>::load reads the pointer under an
+// internal lock bit that it then releases with relaxed ordering, so the read
+// is not ordered before the next store's write: a data race that Thread
+// Sanitizer reports. Use the atomic free functions there, as well as with
+// standard libraries that lack std::atomic<std::shared_ptr> (such as libc++).
+#if defined(__cpp_lib_atomic_shared_ptr) && !defined(__GLIBCXX__)
+template <class T>
+using atomic_shared_ptr = std::atomic<std::shared_ptr<T>>;
+#else
+template <class T>
+class atomic_shared_ptr {
+ public:
+  atomic_shared_ptr(std::shared_ptr<T> p_) noexcept : p(std::move(p_)) {}
+
+  std::shared_ptr<T> load(std::memory_order order) const noexcept {
+    return std::atomic_load_explicit(&p, order);
+  }
+
+  void store(std::shared_ptr<T> desired, std::memory_order order) noexcept {
+    std::atomic_store_explicit(&p, std::move(desired), order);
+  }
+
+ private:
+  std::shared_ptr<T> p;
+};
+#endif
+
+}  // namespace detail
+
+// A mutex_protected that also publishes immutable copies of its value for
+// readers that must never block on the mutex.
+//
+// Writers use lock(), with() and their try_* variants exactly as they would
+// with mutex_protected. snapshot() returns the most recently published copy
+// without blocking on the mutex. Publication is lazy: a writer only copies
+// the value when it releases the lock and a reader has called snapshot()
+// since the last publication, so writes are not slowed down when nobody is
+// reading snapshots. Otherwise the writer only marks the published copy as
+// stale, and the next snapshot() publishes the latest value itself if it can
+// take the mutex without waiting. A snapshot may therefore lag behind writes
+// that are in progress, but once writes stop snapshot() returns the latest
+// value. snapshot() must not be called by a thread that holds the lock.
+template <class T, Mutex M = std::mutex>
+  requires std::copy_constructible<T>
+class snapshot_protected {
+  class publishing_lock;
+  class publishing_guard;
+
+ public:
+  using value_type = T;
+  using mutex_type = M;
+
+  template <typename... Args>
+  snapshot_protected(Args &&...args)
+      : mutex{},
+        v(std::forward<Args>(args)...),
+        published(std::make_shared<const T>(v)),
+        snapshot_requested(false) {}
+
+  snapshot_protected(const T &v_)
+      : mutex{},
+        v(v_),
+        published(std::make_shared<const T>(v)),
+        snapshot_requested(false) {}
+
+  std::shared_ptr<const T> snapshot() const {
+    // Only write the flag when it changes to avoid readers contending on the
+    // cache line.
+    if (!snapshot_requested.load(std::memory_order_relaxed)) {
+      snapshot_requested.store(true, std::memory_order_relaxed);
+    }
+    if (stale()) {
+      // A write finished without publishing. If the mutex is held, its
+      // holder will publish on release as a snapshot has been requested.
+      std::unique_lock guard(mutex, std::try_to_lock);
+      if (guard.owns_lock() && stale()) {
+        publish();
+      }
+    }
+    return published.load(std::memory_order_acquire);
+  }
+
+  mutex_locked<T, publishing_guard> lock() {
+    return mutex_locked<T, publishing_guard>(&v, *this);
+  }
+
+  mutex_locked<T, publishing_lock> try_lock() {
+    return mutex_locked<T, publishing_lock>(&v, *this, std::try_to_lock);
+  }
+
+  template <class Clock, class Duration>
+  mutex_locked<T, publishing_lock> try_lock_until(
+      const std::chrono::time_point<Clock, Duration> &timeout_time)
+    requires TimedMutex<M>
+  {
+    return mutex_locked<T, publishing_lock>(&v, *this, timeout_time);
+  }
+
+  template <class Rep, class Period>
+  mutex_locked<T, publishing_lock> try_lock_for(
+      const std::chrono::duration<Rep, Period> &timeout_duration)
+    requires TimedMutex<M>
+  {
+    return mutex_locked<T, publishing_lock>(&v, *this, timeout_duration);
+  }
+
+  template <typename F>
+  void with(F &&f) {
+    publishing_guard guard(*this);
+    f(v);
+  }
+
+  template <typename F>
+  [[nodiscard]] bool try_with(F &&f) {
+    publishing_lock guard(*this, std::try_to_lock);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <class Clock, class Duration, typename F>
+  [[nodiscard]] bool try_with_until(
+      const std::chrono::time_point<Clock, Duration> &timeout_time, F &&f)
+    requires TimedMutex<M>
+  {
+    publishing_lock guard(*this, timeout_time);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <class Rep, class Period, typename F>
+  [[nodiscard]] bool try_with_for(
+      const std::chrono::duration<Rep, Period> &timeout_duration, F &&f)
+    requires TimedMutex<M>
+  {
+    publishing_lock guard(*this, timeout_duration);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  XYZ_MUTEX_PROTECTED_NOINLINE void with_ref(function_ref<void(T &)> f) {
+    publishing_guard guard(*this);
+    f(v);
+  }
+
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_ref(
+      function_ref<void(T &)> f) {
+    publishing_lock guard(*this, std::try_to_lock);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <class Clock, class Duration>
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_ref_until(
+      const std::chrono::time_point<Clock, Duration> &timeout_time,
+      function_ref<void(T &)> f)
+    requires TimedMutex<M>
+  {
+    publishing_lock guard(*this, timeout_time);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <class Rep, class Period>
+  [[nodiscard]] XYZ_MUTEX_PROTECTED_NOINLINE bool try_with_ref_for(
+      const std::chrono::duration<Rep, Period> &timeout_duration,
+      function_ref<void(T &)> f)
+    requires TimedMutex<M>
+  {
+    publishing_lock guard(*this, timeout_duration);
+    if (guard.owns_lock()) {
+      f(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+ private:
+  // A std::unique_lock that publishes a new snapshot, if one was requested,
+  // before releasing the mutex.
+  class publishing_lock {
+   public:
+    using mutex_type = M;
+
+    template <typename... Args>
+    explicit publishing_lock(snapshot_protected &owner_, Args &&...args)
+        : owner(&owner_), guard(owner_.mutex, std::forward<Args>(args)...) {}
+
+    publishing_lock(publishing_lock &&other) noexcept
+        : owner(std::exchange(other.owner, nullptr)),
+          guard(std::move(other.guard)) {}
+
+    publishing_lock &operator=(publishing_lock &&) = delete;
+
+    ~publishing_lock() {
+      if (owner != nullptr && guard.owns_lock()) {
+        owner->written();
+      }
+    }
+
+    bool owns_lock() const noexcept { return guard.owns_lock(); }
+
+   private:
+    snapshot_protected *owner;
+    std::unique_lock<M> guard;
+  };
+
+  // A publishing_lock that always holds the mutex. Like std::lock_guard it
+  // does not expose owns_lock, so neither does the mutex_locked from lock().
+  class publishing_guard {
+   public:
+    using mutex_type = M;
+
+    explicit publishing_guard(snapshot_protected &owner) : guard(owner) {}
+
+    publishing_guard(const publishing_guard &) = delete;
+    publishing_guard &operator=(const publishing_guard &) = delete;
+
+   private:
+    publishing_lock guard;
+  };
+
+  // Used by `xyz::lock_protected` when locking multiple mutex_protected and
+  // snapshot_protected objects.
+  mutex_locked<T, publishing_lock> adopt_lock() {
+    return mutex_locked<T, publishing_lock>(&v, *this, std::adopt_lock);
+  }
+
+  template <typename... MutexProtected>
+  friend auto lock_protected(MutexProtected &...mp);
+
+  bool stale() const noexcept {
+    return published_version.load(std::memory_order_acquire) !=
+           version.load(std::memory_order_relaxed);
+  }
+
+  // Must be called with the mutex held, after the value may have changed.
+  void written() noexcept {
+    version.store(version.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    if (snapshot_requested.load(std::memory_order_relaxed) &&
+        snapshot_requested.exchange(false, std::memory_order_relaxed)) {
+      publish();
+    }
+  }
+
+  // Must be called with the mutex held.
+  void publish() const noexcept {
+    try {
+      published.store(std::make_shared<const T>(v), std::memory_order_release);
+      published_version.store(version.load(std::memory_order_relaxed),
+                              std::memory_order_release);
+    } catch (...) {
+      // Keep serving the previous snapshot; it is still marked as stale so
+      // the next snapshot() or requested write retries.
+      snapshot_requested.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  // Locked by snapshot() to publish writes that were not published on
+  // release.
+  mutable M mutex;
+  T v;
+  mutable detail::atomic_shared_ptr<const T> published;
+  mutable std::atomic<bool> snapshot_requested;
+  // The number of writes, and the number that had completed when the
+  // published copy was taken. Both are only written with the mutex held.
+  std::atomic<std::uint64_t> version = 0;
+  mutable std::atomic<std::uint64_t> published_version = 0;
+};
+
 }  // namespace xyz
 
+#undef XYZ_MUTEX_PROTECTED_NOINLINE
+
 #endif  // XYZ_MUTEX_PROTECTED_H
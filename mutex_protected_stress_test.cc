@@ -0,0 +1,498 @@
+// A randomized stress test for mutex_protected and the mutex types it can be
+// used with.
+//
+// Many threads run a random mix of lock, try_lock, lock_shared, timed and
+// lock_protected operations against a small set of objects for a fixed
+// duration. Every successful operation is recorded with timestamps from a
+// global logical clock, and the recorded histories are then checked for
+// mutual exclusion and linearizability.
+//
+// The workload can be configured with environment variables:
+//
+//   MUTEX_PROTECTED_STRESS_DURATION_MS  Duration per mutex type (default 100).
+//   MUTEX_PROTECTED_STRESS_THREADS      Number of threads (default 8).
+//   MUTEX_PROTECTED_STRESS_SEED         Seed for the random workload (default
+//                                       random, printed for reproduction).
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cohort_mutex.h"
+#include "gtest/gtest.h"
+#include "mutex_protected.h"
+
+using namespace std::chrono_literals;
+
+namespace xyz {
+namespace {
+
+int env_or(const char* name, int fallback) {
+  const char* value = std::getenv(name);
+  return value != nullptr ? std::stoi(value) : fallback;
+}
+
+struct stress_config {
+  std::chrono::milliseconds duration;
+  int threads;
+  unsigned seed;
+
+  static stress_config from_environment() {
+    return {
+        std::chrono::milliseconds(
+            env_or("MUTEX_PROTECTED_STRESS_DURATION_MS", 100)),
+        env_or("MUTEX_PROTECTED_STRESS_THREADS", 8),
+        static_cast<unsigned>(
+            env_or("MUTEX_PROTECTED_STRESS_SEED",
+                   static_cast<int>(std::random_device{}() >> 1))),
+    };
+  }
+};
+
+// The protected state. Every exclusive operation increments the version, so
+// the version an operation observes identifies its place in the object's
+// history.
+struct versioned {
+  std::uint64_t version = 0;
+};
+
+// A successful operation on one object. `invoke` and `response` are taken
+// before acquiring and after releasing the lock; `enter` and `exit` are taken
+// while the lock is held.
+struct operation {
+  std::size_t object;
+  bool exclusive;
+  std::uint64_t version;
+  std::uint64_t invoke;
+  std::uint64_t enter;
+  std::uint64_t exit;
+  std::uint64_t response;
+};
+
+enum class op_kind {
+  lock,
+  try_lock,
+  with,
+  try_with,
+  try_lock_until,
+  try_lock_for,
+  lock_shared,
+  try_lock_shared,
+  with_shared,
+  try_lock_shared_for,
+  lock_protected,
+};
+
+template <class M>
+std::vector<op_kind> available_operations() {
+  std::vector<op_kind> ops = {op_kind::lock, op_kind::try_lock, op_kind::with,
+                              op_kind::try_with, op_kind::lock_protected};
+  if constexpr (TimedMutex<M>) {
+    ops.push_back(op_kind::try_lock_until);
+#ifndef __SANITIZE_THREAD__
+    // See TimedMutexProtectedTest.TimeoutForWorksCorrectly.
+    ops.push_back(op_kind::try_lock_for);
+#endif
+  }
+  if constexpr (SharedMutex<M>) {
+    ops.push_back(op_kind::lock_shared);
+    ops.push_back(op_kind::try_lock_shared);
+    ops.push_back(op_kind::with_shared);
+#ifndef __SANITIZE_THREAD__
+    if constexpr (TimedMutex<M>) {
+      ops.push_back(op_kind::try_lock_shared_for);
+    }
+#endif
+  }
+  return ops;
+}
+
+// Threads stop early once they have recorded this many operations to bound
+// the memory used by long runs. The test reports threads that stop early and
+// how long they ran.
+constexpr std::size_t max_operations_per_thread = 1 << 20;
+
+// Per-thread state of a running workload.
+struct thread_context {
+  std::vector<operation>& history;
+  // Whether the current operation should yield inside its critical section.
+  bool linger = false;
+};
+
+template <class M>
+class stress_workload {
+ public:
+  static constexpr std::size_t object_count = 4;
+
+  struct run_result {
+    std::uint64_t attempts = 0;
+    // When the thread stopped, earlier than the deadline if it reached
+    // `max_operations_per_thread`.
+    std::chrono::steady_clock::time_point stopped;
+    bool stopped_early = false;
+  };
+
+  // Runs the random workload until `deadline`, appending successful
+  // operations to `history`.
+  run_result run(std::chrono::steady_clock::time_point deadline, unsigned seed,
+                 std::vector<operation>& history) {
+    const std::vector<op_kind> ops = available_operations<M>();
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<std::size_t> pick_op(0, ops.size() - 1);
+    std::uniform_int_distribution<std::size_t> pick_object(0,
+                                                           object_count - 1);
+    // Occasionally yield inside the critical section to widen the window in
+    // which a broken mutex lets another thread in.
+    std::bernoulli_distribution pick_linger(0.125);
+
+    thread_context ctx{history};
+    run_result result;
+    while ((result.stopped = std::chrono::steady_clock::now()) < deadline) {
+      if (history.size() >= max_operations_per_thread) {
+        result.stopped_early = true;
+        break;
+      }
+      const std::size_t i = pick_object(rng);
+      std::size_t j = pick_object(rng);
+      if (j == i) j = (j + 1) % object_count;
+      ctx.linger = pick_linger(rng);
+      run_one(ops[pick_op(rng)], i, j, ctx);
+      ++result.attempts;
+    }
+    return result;
+  }
+
+  std::uint64_t final_version(std::size_t i) {
+    return values[i].lock()->version;
+  }
+
+ private:
+  std::uint64_t tick() { return clock.fetch_add(1); }
+
+  template <class Locked>
+  void write_locked(Locked& locked, std::size_t i, std::uint64_t invoke,
+                    thread_context& ctx) {
+    operation op{i, true, 0, invoke, tick(), 0, 0};
+    op.version = locked->version;
+    if (ctx.linger) std::this_thread::yield();
+    locked->version = op.version + 1;
+    op.exit = tick();
+    ctx.history.push_back(op);
+  }
+
+  template <class Locked>
+  void read_locked(Locked& locked, std::size_t i, std::uint64_t invoke,
+                   thread_context& ctx) {
+    operation op{i, false, 0, invoke, tick(), 0, 0};
+    op.version = locked->version;
+    if (ctx.linger) std::this_thread::yield();
+    op.exit = tick();
+    ctx.history.push_back(op);
+  }
+
+  void run_one(op_kind kind, std::size_t i, std::size_t j,
+               thread_context& ctx) {
+    const std::size_t recorded = ctx.history.size();
+    const std::uint64_t invoke = tick();
+    switch (kind) {
+      case op_kind::lock: {
+        auto locked = values[i].lock();
+        write_locked(locked, i, invoke, ctx);
+        break;
+      }
+      case op_kind::try_lock: {
+        if (auto locked = values[i].try_lock()) {
+          write_locked(locked, i, invoke, ctx);
+        }
+        break;
+      }
+      case op_kind::with: {
+        values[i].with([&](versioned& v) {
+          versioned* p = &v;
+          write_locked(p, i, invoke, ctx);
+        });
+        break;
+      }
+      case op_kind::try_with: {
+        (void)values[i].try_with([&](versioned& v) {
+          versioned* p = &v;
+          write_locked(p, i, invoke, ctx);
+        });
+        break;
+      }
+      case op_kind::try_lock_until: {
+        if constexpr (TimedMutex<M>) {
+          auto timeout = std::chrono::system_clock::now() + 100us;
+          if (auto locked = values[i].try_lock_until(timeout)) {
+            write_locked(locked, i, invoke, ctx);
+          }
+        }
+        break;
+      }
+      case op_kind::try_lock_for: {
+        if constexpr (TimedMutex<M>) {
+          if (auto locked = values[i].try_lock_for(100us)) {
+            write_locked(locked, i, invoke, ctx);
+          }
+        }
+        break;
+      }
+      case op_kind::lock_shared: {
+        if constexpr (SharedMutex<M>) {
+          auto locked = values[i].lock_shared();
+          read_locked(locked, i, invoke, ctx);
+        }
+        break;
+      }
+      case op_kind::try_lock_shared: {
+        if constexpr (SharedMutex<M>) {
+          if (auto locked = values[i].try_lock_shared()) {
+            read_locked(locked, i, invoke, ctx);
+          }
+        }
+        break;
+      }
+      case op_kind::with_shared: {
+        if constexpr (SharedMutex<M>) {
+          values[i].with_shared([&](const versioned& v) {
+            const versioned* p = &v;
+            read_locked(p, i, invoke, ctx);
+          });
+        }
+        break;
+      }
+      case op_kind::try_lock_shared_for: {
+        if constexpr (SharedMutex<M> && TimedMutex<M>) {
+          if (auto locked = values[i].try_lock_shared_for(100us)) {
+            read_locked(locked, i, invoke, ctx);
+          }
+        }
+        break;
+      }
+      case op_kind::lock_protected: {
+        auto [a, b] = xyz::lock_protected(values[i], values[j]);
+        write_locked(a, i, invoke, ctx);
+        write_locked(b, j, invoke, ctx);
+        break;
+      }
+    }
+    // The response is only known once the lock has been released.
+    const std::uint64_t response = tick();
+    for (std::size_t k = recorded; k < ctx.history.size(); ++k) {
+      ctx.history[k].response = response;
+    }
+  }
+
+  std::array<mutex_protected<versioned, M>, object_count> values;
+  std::atomic<std::uint64_t> clock = 0;
+};
+
+// No operation may hold the lock while an exclusive operation holds it.
+std::string check_mutual_exclusion(std::vector<operation> ops) {
+  std::sort(ops.begin(), ops.end(),
+            [](const operation& a, const operation& b) {
+              return a.enter < b.enter;
+            });
+  std::uint64_t exclusive_exit = 0;
+  std::uint64_t shared_exit = 0;
+  for (const operation& op : ops) {
+    if (op.enter < exclusive_exit || (op.exclusive && op.enter < shared_exit)) {
+      return "critical sections overlap at time " + std::to_string(op.enter);
+    }
+    (op.exclusive ? exclusive_exit : shared_exit) =
+        std::max(op.exclusive ? exclusive_exit : shared_exit, op.exit);
+  }
+  return "";
+}
+
+// Exclusive operations read-modify-write the version and shared operations
+// read it, so a history is linearizable if and only if
+// - every version is written exactly once, and
+// - ordering operations by the version they write (or read, after the write)
+//   never puts an operation before one that completed before it started.
+std::string check_linearizable(std::vector<operation> ops,
+                               std::uint64_t final_version) {
+  // The position of an operation in the only possible linearization. Reads
+  // of the same version may be linearized in any order.
+  auto key = [](const operation& op) {
+    return op.exclusive ? 2 * (op.version + 1) : 2 * op.version + 1;
+  };
+  std::sort(ops.begin(), ops.end(),
+            [&key](const operation& a, const operation& b) {
+              return key(a) < key(b);
+            });
+
+  std::uint64_t writes = 0;
+  for (const operation& op : ops) {
+    if (op.exclusive && op.version != writes++) {
+      return "version " + std::to_string(op.version) +
+             " was not written exactly once";
+    }
+    if (!op.exclusive && op.version > final_version) {
+      return "read of unwritten version " + std::to_string(op.version);
+    }
+  }
+  if (writes != final_version) {
+    return "final version " + std::to_string(final_version) + " after " +
+           std::to_string(writes) + " writes";
+  }
+
+  // Walk from the end of the linearization, tracking the earliest response
+  // of any operation strictly later in it.
+  std::uint64_t earliest_later_response = UINT64_MAX;
+  for (auto group_end = ops.rbegin(); group_end != ops.rend();) {
+    auto group_begin = std::find_if(
+        group_end, ops.rend(),
+        [&](const operation& op) { return key(op) != key(*group_end); });
+    for (auto it = group_end; it != group_begin; ++it) {
+      if (earliest_later_response < it->invoke) {
+        return std::string(it->exclusive ? "write" : "read") + " of version " +
+               std::to_string(it->version) +
+               " is ordered after an operation that completed before it "
+               "started";
+      }
+    }
+    for (auto it = group_end; it != group_begin; ++it) {
+      earliest_later_response = std::min(earliest_later_response, it->response);
+    }
+    group_end = group_begin;
+  }
+  return "";
+}
+
+template <typename T>
+class MutexProtectedStressTest : public testing::Test {};
+
+// Threads are spread evenly across the simulated nodes by index.
+using two_node_topology = simulated_topology<2>;
+
+using AllMutexes =
+    ::testing::Types<std::mutex, std::timed_mutex, std::recursive_mutex,
+                     std::recursive_timed_mutex, std::shared_mutex,
+                     std::shared_timed_mutex, cohort_mutex,
+                     basic_cohort_mutex<two_node_topology>>;
+TYPED_TEST_SUITE(MutexProtectedStressTest, AllMutexes);
+
+TYPED_TEST(MutexProtectedStressTest, HistoryIsLinearizable) {
+  const stress_config config = stress_config::from_environment();
+  std::cout << "duration: " << config.duration.count()
+            << "ms threads: " << config.threads << " seed: " << config.seed
+            << std::endl;
+
+  stress_workload<TypeParam> workload;
+  std::vector<std::vector<operation>> histories(config.threads);
+  std::vector<typename stress_workload<TypeParam>::run_result> results(
+      config.threads);
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto deadline = start + config.duration;
+  std::vector<std::thread> threads;
+  threads.reserve(config.threads);
+  for (int t = 0; t < config.threads; ++t) {
+    threads.emplace_back([&, t]() {
+      two_node_topology::node = t % 2;
+      results[t] = workload.run(deadline, config.seed + t, histories[t]);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::vector<std::vector<operation>> by_object(
+      stress_workload<TypeParam>::object_count);
+  std::uint64_t total_attempts = 0;
+  int stopped_early = 0;
+  for (int t = 0; t < config.threads; ++t) {
+    total_attempts += results[t].attempts;
+    if (results[t].stopped_early) {
+      ++stopped_early;
+      const std::chrono::duration<double, std::milli> ran =
+          results[t].stopped - start;
+      std::cout << "thread " << t << " stopped early after "
+                << static_cast<std::uint64_t>(ran.count()) << "ms with "
+                << max_operations_per_thread << " operations" << std::endl;
+    }
+    for (const operation& op : histories[t]) {
+      by_object[op.object].push_back(op);
+    }
+  }
+  std::uint64_t total_operations = 0;
+  for (std::size_t i = 0; i < by_object.size(); ++i) {
+    total_operations += by_object[i].size();
+    EXPECT_EQ(check_mutual_exclusion(by_object[i]), "") << "object " << i;
+    EXPECT_EQ(check_linearizable(by_object[i], workload.final_version(i)), "")
+        << "object " << i;
+  }
+
+  const double throughput = total_attempts / elapsed.count();
+  const auto elapsed_ms = static_cast<std::uint64_t>(elapsed.count() * 1000);
+  std::cout << "ran: " << elapsed_ms << "ms stopped early: " << stopped_early
+            << " attempts: " << total_attempts
+            << " recorded: " << total_operations
+            << " throughput: " << static_cast<std::uint64_t>(throughput)
+            << " ops/s" << std::endl;
+  this->RecordProperty("elapsed_ms", std::to_string(elapsed_ms));
+  this->RecordProperty("stopped_early", std::to_string(stopped_early));
+  this->RecordProperty("attempts", std::to_string(total_attempts));
+  this->RecordProperty("recorded", std::to_string(total_operations));
+  this->RecordProperty("ops_per_second",
+                       std::to_string(static_cast<std::uint64_t>(throughput)));
+}
+
+// Make sure the checkers reject broken histories, not just accept good ones.
+TEST(StressCheckTest, DetectsOverlappingExclusiveSections) {
+  std::vector<operation> ops = {
+      {0, true, 0, 0, 1, 4, 5},
+      {0, true, 1, 2, 3, 6, 7},
+  };
+  EXPECT_NE(check_mutual_exclusion(ops), "");
+}
+
+TEST(StressCheckTest, AllowsOverlappingSharedSections) {
+  std::vector<operation> ops = {
+      {0, false, 0, 0, 1, 4, 5},
+      {0, false, 0, 2, 3, 6, 7},
+      {0, true, 0, 8, 9, 10, 11},
+  };
+  EXPECT_EQ(check_mutual_exclusion(ops), "");
+  EXPECT_EQ(check_linearizable(ops, 1), "");
+}
+
+TEST(StressCheckTest, DetectsLostUpdate) {
+  std::vector<operation> ops = {
+      {0, true, 0, 0, 1, 2, 3},
+      {0, true, 0, 4, 5, 6, 7},
+  };
+  EXPECT_NE(check_linearizable(ops, 1), "");
+}
+
+TEST(StressCheckTest, DetectsStaleRead) {
+  std::vector<operation> ops = {
+      {0, true, 0, 0, 1, 2, 3},
+      {0, false, 0, 4, 5, 6, 7},
+  };
+  EXPECT_NE(check_linearizable(ops, 1), "");
+}
+
+TEST(StressCheckTest, DetectsReadsGoingBackInTime) {
+  std::vector<operation> ops = {
+      {0, true, 0, 0, 1, 10, 11},
+      {0, false, 1, 2, 3, 4, 5},
+      {0, false, 0, 6, 7, 8, 9},
+  };
+  EXPECT_NE(check_linearizable(ops, 1), "");
+}
+
+}  // namespace
+}  // namespace xyz
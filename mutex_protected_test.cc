@@ -1,6 +1,7 @@
 #include "mutex_protected.h"
 
 #include <chrono>
+#include <memory>
 #include <string>
 #include <thread>
 #include <type_traits>
@@ -111,6 +112,26 @@ TYPED_TEST(MutexProtectedTest, UseWithToModifyInLambda) {
   EXPECT_EQ(*value.lock(), 1);
 }
 
+TYPED_TEST(MutexProtectedTest, UseWithRefToModifyInLambda) {
+  mutex_protected<int, TypeParam> value(0);
+  int calls = 0;
+  value.with_ref([&calls](int& v) {
+    v++;
+    calls++;
+  });
+  EXPECT_EQ(*value.lock(), 1);
+  EXPECT_EQ(calls, 1);
+}
+
+void increment(int& v) { v++; }
+
+TYPED_TEST(MutexProtectedTest, UseWithRefWithFunction) {
+  mutex_protected<int, TypeParam> value(0);
+  value.with_ref(increment);
+  EXPECT_TRUE(value.try_with_ref(increment));
+  EXPECT_EQ(*value.lock(), 2);
+}
+
 TYPED_TEST(MutexProtectedTest, TryLockGetsLockWithoutContention) {
   mutex_protected<int, TypeParam> value(0);
 
@@ -152,6 +173,19 @@ TYPED_TEST(MutexProtectedTest, TryWithFailsIfLocked) {
   EXPECT_EQ(*value.lock(), 0);
 }
 
+TYPED_TEST(MutexProtectedTest, TryWithRefFailsIfLocked) {
+  mutex_protected<int, TypeParam> value(0);
+  {
+    auto locked = value.lock();
+    std::thread t(
+        [&value]() { EXPECT_FALSE(value.try_with_ref([](int& v) { v++; })); });
+    t.join();
+  }
+  EXPECT_EQ(*value.lock(), 0);
+  EXPECT_TRUE(value.try_with_ref([](int& v) { v++; }));
+  EXPECT_EQ(*value.lock(), 1);
+}
+
 TYPED_TEST(MutexProtectedTest, ThreadSafetyCorrectnessLock) {
   mutex_protected<int, TypeParam> value(0);
 
@@ -239,6 +273,16 @@ TYPED_TEST(SharedMutexProtectedTest, SharedLockIsConst) {
       static_assert(std::is_const_v<std::remove_reference_t<decltype(v)>>);
     }));
   }
+  {
+    value.with_shared_ref([](auto& v) {
+      static_assert(std::is_const_v<std::remove_reference_t<decltype(v)>>);
+    });
+  }
+  {
+    ASSERT_TRUE(value.try_with_shared_ref([](auto& v) {
+      static_assert(std::is_const_v<std::remove_reference_t<decltype(v)>>);
+    }));
+  }
 }
 
 TYPED_TEST(SharedMutexProtectedTest, TwoSharedLockSucceeds) {
@@ -247,6 +291,8 @@ TYPED_TEST(SharedMutexProtectedTest, TwoSharedLockSucceeds) {
   auto locked = value.lock_shared();
   std::thread t([&value]() {
     EXPECT_TRUE(value.try_with_shared([](const int& v) { EXPECT_EQ(v, 0); }));
+    EXPECT_TRUE(
+        value.try_with_shared_ref([](const int& v) { EXPECT_EQ(v, 0); }));
     auto locked = value.try_lock_shared();
     EXPECT_TRUE(locked.owns_lock());
     EXPECT_TRUE(locked);
@@ -260,6 +306,8 @@ TYPED_TEST(SharedMutexProtectedTest, LockThenSharedFails) {
   auto locked = value.lock();
   std::thread t([&value]() {
     EXPECT_FALSE(value.try_with_shared([](const int& v) { EXPECT_EQ(v, 0); }));
+    EXPECT_FALSE(
+        value.try_with_shared_ref([](const int& v) { EXPECT_EQ(v, 0); }));
     auto locked = value.try_lock_shared();
     EXPECT_FALSE(locked.owns_lock());
     EXPECT_FALSE(locked);
@@ -341,6 +389,10 @@ TYPED_TEST(TimedMutexProtectedTest, TimeoutUntilWorksCorrectly) {
     ASSERT_TRUE(
         value.try_with_until(now() + 1ms, [&out](auto& v) { out += v; }));
   }
+  {
+    ASSERT_TRUE(
+        value.try_with_ref_until(now() + 1ms, [&out](auto& v) { out += v; }));
+  }
   auto write_locked = value.lock();
   std::thread t([&value, &out]() {
     {
@@ -351,9 +403,13 @@ TYPED_TEST(TimedMutexProtectedTest, TimeoutUntilWorksCorrectly) {
       ASSERT_FALSE(
           value.try_with_until(now() + 1ms, [&out](auto& v) { out += v; }));
     }
+    {
+      ASSERT_FALSE(value.try_with_ref_until(now() + 1ms,
+                                            [&out](auto& v) { out += v; }));
+    }
   });
   t.join();
-  EXPECT_EQ(out, 2);
+  EXPECT_EQ(out, 3);
   EXPECT_EQ(*write_locked, 1);
 }
 
@@ -378,6 +434,9 @@ TYPED_TEST(TimedMutexProtectedTest, TimeoutForWorksCorrectly) {
   {
     ASSERT_TRUE(value.try_with_for(1ms, [&out](auto& v) { out += v; }));
   }
+  {
+    ASSERT_TRUE(value.try_with_ref_for(1ms, [&out](auto& v) { out += v; }));
+  }
   auto write_locked = value.lock();
   std::thread t([&value, &out]() {
     {
@@ -387,9 +446,12 @@ TYPED_TEST(TimedMutexProtectedTest, TimeoutForWorksCorrectly) {
     {
       ASSERT_FALSE(value.try_with_for(1ms, [&out](auto& v) { out += v; }));
     }
+    {
+      ASSERT_FALSE(value.try_with_ref_for(1ms, [&out](auto& v) { out += v; }));
+    }
   });
   t.join();
-  EXPECT_EQ(out, 2);
+  EXPECT_EQ(out, 3);
   EXPECT_EQ(*write_locked, 1);
 }
 
@@ -414,6 +476,16 @@ TEST(SharedTimedMutexProtectedTest, SharedLockIsConst) {
       static_assert(std::is_const_v<std::remove_reference_t<decltype(v)>>);
     }));
   }
+  {
+    ASSERT_TRUE(value.try_with_shared_ref_until(now() + 1ms, [](auto& v) {
+      static_assert(std::is_const_v<std::remove_reference_t<decltype(v)>>);
+    }));
+  }
+  {
+    ASSERT_TRUE(value.try_with_shared_ref_for(1ms, [](auto& v) {
+      static_assert(std::is_const_v<std::remove_reference_t<decltype(v)>>);
+    }));
+  }
 }
 
 TEST(SharedTimedMutexProtectedTest, TimeoutWorksCorrectly) {
@@ -437,6 +509,14 @@ TEST(SharedTimedMutexProtectedTest, TimeoutWorksCorrectly) {
   {
     ASSERT_TRUE(value.try_with_shared_for(1ms, [&out](auto& v) { out += v; }));
   }
+  {
+    ASSERT_TRUE(value.try_with_shared_ref_until(
+        now() + 1ms, [&out](auto& v) { out += v; }));
+  }
+  {
+    ASSERT_TRUE(
+        value.try_with_shared_ref_for(1ms, [&out](auto& v) { out += v; }));
+  }
   auto write_locked = value.lock();
   std::thread t([&value, &out]() {
     {
@@ -455,10 +535,270 @@ TEST(SharedTimedMutexProtectedTest, TimeoutWorksCorrectly) {
       ASSERT_FALSE(
           value.try_with_shared_for(1ms, [&out](auto& v) { out += v; }));
     }
+    {
+      ASSERT_FALSE(value.try_with_shared_ref_until(
+          now() + 1ms, [&out](auto& v) { out += v; }));
+    }
+    {
+      ASSERT_FALSE(
+          value.try_with_shared_ref_for(1ms, [&out](auto& v) { out += v; }));
+    }
   });
   t.join();
-  EXPECT_EQ(out, 4);
+  EXPECT_EQ(out, 6);
   EXPECT_EQ(*write_locked, 1);
 }
 
+int add_one(int i) { return i + 1; }
+
+TEST(FunctionRefTest, CallsLambda) {
+  int calls = 0;
+  auto lambda = [&calls](int i) {
+    calls++;
+    return i * 2;
+  };
+  function_ref<int(int)> f = lambda;
+  EXPECT_EQ(f(2), 4);
+  EXPECT_EQ(f(3), 6);
+  EXPECT_EQ(calls, 2);
+}
+
+TEST(FunctionRefTest, CallsFunctionPointer) {
+  auto* p = &add_one;
+  function_ref<int(int)> f = p;
+  p = nullptr;
+  EXPECT_EQ(f(1), 2);
+}
+
+TEST(FunctionRefTest, CallsTemporaryFunctionPointer) {
+  // The pointer is stored by value, so it outlives the temporary.
+  function_ref<int(int)> f = &add_one;
+  EXPECT_EQ(f(1), 2);
+  function_ref<long(int)> g = &add_one;
+  EXPECT_EQ(g(1), 2L);
+}
+
+TEST(FunctionRefTest, CallsFunction) {
+  function_ref<int(int)> f = add_one;
+  EXPECT_EQ(f(1), 2);
+  function_ref<long(int)> g = add_one;
+  EXPECT_EQ(g(1), 2L);
+}
+
+TEST(FunctionRefTest, ConvertsReturnType) {
+  auto lambda = [](int i) { return i; };
+  function_ref<long(int)> f = lambda;
+  EXPECT_EQ(f(1), 1L);
+  function_ref<void(int)> g = lambda;
+  g(1);
+}
+
+TEST(FunctionRefTest, CopiesReferToSameCallable) {
+  int calls = 0;
+  auto lambda = [&calls]() { calls++; };
+  function_ref<void()> f = lambda;
+  function_ref<void()> g = f;
+  f();
+  g();
+  EXPECT_EQ(calls, 2);
+  static_assert(std::is_trivially_copyable_v<function_ref<void()>>);
+}
+
+template <typename T>
+class SnapshotProtectedTest : public testing::Test {};
+
+TYPED_TEST_SUITE(SnapshotProtectedTest, AllMutexes);
+
+TYPED_TEST(SnapshotProtectedTest, InitialSnapshot) {
+  snapshot_protected<std::string, TypeParam> value("hello");
+  auto snapshot = value.snapshot();
+  static_assert(std::is_same_v<decltype(snapshot),
+                               std::shared_ptr<const std::string>>);
+  EXPECT_EQ(*snapshot, "hello");
+}
+
+TYPED_TEST(SnapshotProtectedTest, PublishesOnlyWhenRequested) {
+  snapshot_protected<int, TypeParam> value(0);
+  auto first = value.snapshot();
+
+  // The request made by the snapshot above is served by this write.
+  value.with([](int& v) { v = 1; });
+  {
+    // No snapshot has been requested since the last publication so releasing
+    // this lock does not copy the value.
+    auto locked = value.lock();
+    *locked = 2;
+  }
+  {
+    // A snapshot taken while a writer holds the lock does not wait for it.
+    auto locked = value.lock();
+    *locked = 3;
+    std::thread t([&value]() { EXPECT_EQ(*value.snapshot(), 1); });
+    t.join();
+  }
+  // The snapshot call above requested another publication.
+  EXPECT_EQ(*value.snapshot(), 3);
+  EXPECT_EQ(*first, 0);
+}
+
+TYPED_TEST(SnapshotProtectedTest, SnapshotCatchesUpAfterWritesStop) {
+  snapshot_protected<int, TypeParam> value(0);
+  value.snapshot();
+  value.with([](int& v) { v = 1; });
+  // Nothing requested these writes, and no more writes follow.
+  value.with([](int& v) { v = 2; });
+  value.with([](int& v) { v = 3; });
+  std::thread t([&value]() {
+    while (*value.snapshot() != 3) {
+      std::this_thread::yield();
+    }
+  });
+  t.join();
+  EXPECT_EQ(*value.snapshot(), 3);
+}
+
+TYPED_TEST(SnapshotProtectedTest, LockPublishesOnRelease) {
+  snapshot_protected<std::vector<int>, TypeParam> value;
+  EXPECT_TRUE(value.snapshot()->empty());
+  {
+    auto locked = value.lock();
+    locked->push_back(1);
+    EXPECT_TRUE(value.snapshot()->empty());
+  }
+  EXPECT_EQ(*value.snapshot(), (std::vector<int>{1}));
+}
+
+TYPED_TEST(SnapshotProtectedTest, MovedLockPublishesOnce) {
+  snapshot_protected<int, TypeParam> value(0);
+  value.snapshot();
+  {
+    auto locked = value.try_lock();
+    ASSERT_TRUE(locked);
+    *locked = 1;
+    auto moved = std::move(locked);
+    *moved = 2;
+  }
+  EXPECT_EQ(*value.snapshot(), 2);
+}
+
+template <class Locked>
+concept HasOwnsLock = requires(const Locked& locked) { locked.owns_lock(); };
+
+TYPED_TEST(SnapshotProtectedTest, OnlyTryLockExposesOwnsLock) {
+  snapshot_protected<int, TypeParam> value(0);
+  static_assert(!HasOwnsLock<decltype(value.lock())>);
+  static_assert(HasOwnsLock<decltype(value.try_lock())>);
+  static_assert(!HasOwnsLock<decltype(mutex_protected<int>().lock())>);
+}
+
+TYPED_TEST(SnapshotProtectedTest, UseWithRef) {
+  snapshot_protected<int, TypeParam> value(0);
+  value.snapshot();
+  value.with_ref([](int& v) { v++; });
+  EXPECT_EQ(*value.snapshot(), 1);
+  EXPECT_TRUE(value.try_with_ref([](int& v) { v++; }));
+  EXPECT_EQ(*value.snapshot(), 2);
+}
+
+TYPED_TEST(SnapshotProtectedTest, LockMultiple) {
+  snapshot_protected<int, TypeParam> a(1);
+  mutex_protected<int, TypeParam> b(2);
+  a.snapshot();
+  {
+    auto [la, lb] = xyz::lock_protected(a, b);
+    *la += 10;
+    *lb += 10;
+  }
+  EXPECT_EQ(*a.snapshot(), 11);
+  {
+    auto [lb, la] = xyz::lock_protected(b, a);
+    EXPECT_EQ(*la, 11);
+    EXPECT_EQ(*lb, 12);
+  }
+}
+
+TYPED_TEST(SnapshotProtectedTest, TryWithFailsIfLocked) {
+  snapshot_protected<int, TypeParam> value(0);
+  {
+    auto locked = value.lock();
+    std::thread t(
+        [&value]() { EXPECT_FALSE(value.try_with([](int& v) { v++; })); });
+    t.join();
+  }
+  EXPECT_TRUE(value.try_with([](int& v) { v++; }));
+  EXPECT_EQ(*value.lock(), 1);
+}
+
+TYPED_TEST(SnapshotProtectedTest, SnapshotsAreMonotonic) {
+  snapshot_protected<int, TypeParam> value(0);
+
+  const int readers = 4;
+  const int writers = 4;
+  const int iters = 10000;
+
+  std::vector<std::thread> threads;
+  threads.reserve(readers + writers);
+  for (int i = 0; i < writers; ++i) {
+    threads.emplace_back([&value]() {
+      for (int j = 0; j < iters; ++j) {
+        value.with([](int& v) { v++; });
+      }
+    });
+  }
+  for (int i = 0; i < readers; ++i) {
+    threads.emplace_back([&value]() {
+      int last = 0;
+      for (int j = 0; j < iters; ++j) {
+        int current = *value.snapshot();
+        EXPECT_LE(last, current);
+        last = current;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(*value.lock(), writers * iters);
+  EXPECT_LE(*value.snapshot(), writers * iters);
+}
+
+TEST(TimedSnapshotProtectedTest, TimeoutWorksCorrectly) {
+#ifdef __SANITIZE_THREAD__
+  // See TimedMutexProtectedTest.TimeoutForWorksCorrectly.
+  GTEST_SKIP()
+      << "Skipping due to known TSAN false positive (llvm/llvm-project#62623)";
+#endif
+
+  snapshot_protected<int, std::timed_mutex> value(1);
+  value.snapshot();
+  ASSERT_TRUE(value.try_with_for(1ms, [](int& v) { v++; }));
+  EXPECT_EQ(*value.snapshot(), 2);
+  ASSERT_TRUE(value.try_with_until(now() + 1ms, [](int& v) { v++; }));
+  EXPECT_EQ(*value.snapshot(), 3);
+  {
+    auto locked = value.try_lock_for(1ms);
+    ASSERT_TRUE(locked.owns_lock());
+    *locked += 1;
+  }
+  EXPECT_EQ(*value.snapshot(), 4);
+  {
+    auto locked = value.try_lock_until(now() + 1ms);
+    ASSERT_TRUE(locked.owns_lock());
+    *locked += 1;
+  }
+  EXPECT_EQ(*value.snapshot(), 5);
+  ASSERT_TRUE(value.try_with_ref_for(1ms, [](int& v) { v++; }));
+  ASSERT_TRUE(value.try_with_ref_until(now() + 1ms, [](int& v) { v++; }));
+  EXPECT_EQ(*value.snapshot(), 7);
+
+  auto write_locked = value.lock();
+  std::thread t([&value]() {
+    auto locked = value.try_lock_until(now() + 1ms);
+    EXPECT_FALSE(locked.owns_lock());
+    EXPECT_FALSE(value.try_with_until(now() + 1ms, [](int& v) { v++; }));
+  });
+  t.join();
+  EXPECT_EQ(*write_locked, 7);
+}
+
 }  // namespace xyz
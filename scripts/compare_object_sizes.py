@@ -0,0 +1,97 @@
+"""Compare the code size of object files and count the copies of the mutex
+locking code each one contains.
+
+Inlined copies of `with` have no symbols of their own, so copies of the
+locking code are counted as relocations against the mutex lock function,
+one per call site that locks the mutex.
+
+The object files must contain machine code rather than LTO IR.
+
+Usage:
+```
+python scripts/compare_object_sizes.py --nm nm --objdump objdump \
+    with=with.o with_ref=with_ref.o
+```
+"""
+
+import argparse
+import re
+import subprocess
+
+# pthread_mutex_lock is called inline by libstdc++'s std::mutex::lock (with a
+# leading underscore on Darwin); libc++ calls the out-of-line
+# std::__1::mutex::lock().
+_DEFAULT_LOCK_SYMBOL = r"^_?pthread_mutex_lock$|^_?_ZNSt3__15mutex4lockEv$"
+
+
+def text_size(nm: str, path: str) -> int:
+    """Sum the sizes of all symbols in the text section of an object file."""
+    output = subprocess.run(
+        [nm, "--print-size", "--defined-only", path],
+        check=True,
+        capture_output=True,
+        text=True,
+    ).stdout
+    total = 0
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "tTwW":
+            total += int(fields[1], 16)
+    return total
+
+
+def lock_call_sites(objdump: str, path: str, lock_symbol: re.Pattern[str]) -> int:
+    """Count the relocations against the mutex lock function in an object file."""
+    output = subprocess.run(
+        [objdump, "--reloc", path],
+        check=True,
+        capture_output=True,
+        text=True,
+    ).stdout
+    count = 0
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) != 3:
+            continue
+        # Relocation targets are printed as symbol[+-]addend.
+        symbol = re.split(r"[+-]0x", fields[2], maxsplit=1)[0]
+        if lock_symbol.search(symbol):
+            count += 1
+    return count
+
+
+def main(argv: list[str] | None = None) -> None:
+    """Main entry point for script execution."""
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--nm", default="nm", help="The nm executable to use")
+    parser.add_argument(
+        "--objdump", default="objdump", help="The objdump executable to use"
+    )
+    parser.add_argument(
+        "--lock-symbol",
+        default=_DEFAULT_LOCK_SYMBOL,
+        help="Regular expression matching the mutex lock function",
+    )
+    parser.add_argument(
+        "objects",
+        help="Object files to compare, each given as <label>=<path>",
+        nargs="+",
+    )
+    args = parser.parse_args(argv)
+    lock_symbol = re.compile(args.lock_symbol)
+
+    print(f"{'label':<16}{'text bytes':>12}{'lock call sites':>18}")
+    for entry in args.objects:
+        label, path = entry.split("=", 1)
+        size = text_size(args.nm, path)
+        if size == 0:
+            raise SystemExit(f"{path} has no machine code; is it an LTO object?")
+        print(
+            f"{label:<16}{size:>12}"
+            f"{lock_call_sites(args.objdump, path, lock_symbol):>18}"
+        )
+
+
+if __name__ == "__main__":
+    main()